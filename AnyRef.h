@@ -7,6 +7,46 @@
 #include <utility>
 #include <tuple>
 #include <typeindex>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <typeinfo>
+#include <cstdint>
+#include <cstring>
+#if defined(__GLIBCXX__)
+#include <cxxabi.h>
+#endif
+
+#if defined(_MSC_VER)
+#define ANYREF_NOINLINE __declspec(noinline)
+#else
+#define ANYREF_NOINLINE __attribute__((noinline))
+#endif
+
+//ANYREF_SIMD enables the SSE2/AVX2/AVX-512 variants of the arithmetic kernels, selected at runtime by CPU detection.
+//They are written with the vector extensions of GCC and Clang, so the other compilers use the scalar kernels.
+//Define ANYREF_SIMD as 0 to disable them.
+#if !defined(ANYREF_SIMD)
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ANYREF_SIMD 1
+#else
+#define ANYREF_SIMD 0
+#endif
+#endif
+//ANYREF_EXCEPTIONS enables Is<Base>/Get<Base> on references to derived classes, which needs throw and catch (see UpcastCache).
+//It is 0 when exceptions are disabled (e.g. -fno-exceptions), and then Is/Get accept only the exact type.
+#if !defined(ANYREF_EXCEPTIONS)
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define ANYREF_EXCEPTIONS 1
+#else
+#define ANYREF_EXCEPTIONS 0
+#endif
+#endif
+#if ANYREF_SIMD
+#define ANYREF_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define ANYREF_ALWAYS_INLINE inline
+#endif
 
 namespace anyref
 {
@@ -40,6 +80,309 @@ public:
 template <class T>
 using RemoveCVRefT = std::remove_cv_t<std::remove_reference_t<T>>;
 
+//true if T has data() and size() and stores arithmetic elements contiguously.
+//std::vector<bool> does not have data(), so it is false.
+template <class T, class = void>
+struct IsArithmeticArray : std::false_type {};
+template <class T>
+struct IsArithmeticArray<T, std::void_t<decltype(std::declval<T&>().data()), decltype(std::declval<T&>().size())>>
+{
+	using Pointer = decltype(std::declval<T&>().data());
+	static constexpr bool value = std::is_pointer_v<Pointer> &&
+		std::is_arithmetic_v<std::remove_cv_t<std::remove_pointer_t<Pointer>>>;
+};
+template <class T>
+inline constexpr bool IsArithmeticArrayV = IsArithmeticArray<RemoveCVRefT<T>>::value;
+
+//Runtime dispatch of SIMD kernels.
+//A kernel is a class with
+//	static constexpr bool Vectorizable;
+//	template <int Width> static ANYREF_ALWAYS_INLINE Ret Run(Args...);
+//where Width is the size of the vector registers in bytes, or 0 for the scalar version.
+//DispatchSimd<Kernel>(args...) calls Run<Width> inside a function compiled for the best instruction set the CPU supports,
+//so that the vector operations in Run are compiled into the instructions of that set.
+enum class SimdLevel { Scalar, SSE2, AVX2, AVX512 };
+
+inline SimdLevel GetSimdLevel()
+{
+#if ANYREF_SIMD
+	static const SimdLevel level = []()
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+			__builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) return SimdLevel::AVX512;
+		if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+		return SimdLevel::Scalar;
+	}();
+	return level;
+#else
+	return SimdLevel::Scalar;
+#endif
+}
+
+//true if T can be an element of the vector types, i.e. integers except bool, float and double.
+template <class T>
+inline constexpr bool IsSimdElementV = (std::is_integral_v<T> && !std::is_same_v<T, bool>) ||
+									   std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+#if ANYREF_SIMD
+template <class T, int N>
+struct SimdVector
+{
+	typedef T Type __attribute__((vector_size(N * sizeof(T))));
+};
+//N elements of T. The elements are converted to the type of the vector, which may have another element type.
+template <class T, int N>
+using SimdVectorT = typename SimdVector<T, N>::Type;
+
+//the number of elements processed at once.
+//Basically the widest of Types fills a register, but the narrowest one fills at least 16 bytes,
+//because GCC does not vectorize the conversion from/to vectors smaller than that well (e.g. 2 ints to 2 doubles on SSE2).
+template <int Width, class ...Types>
+constexpr int SimdLanes()
+{
+	std::size_t widest = 1, narrowest = Width;
+	((widest = sizeof(Types) > widest ? sizeof(Types) : widest), ...);
+	((narrowest = sizeof(Types) < narrowest ? sizeof(Types) : narrowest), ...);
+	std::size_t n = Width / widest, m = 16 / narrowest;
+	return static_cast<int>(n > m ? n : m);
+}
+
+//The vectors are passed by reference, because passing them by value changes the ABI depending on the instruction set.
+//loads N elements of T from p and converts them to the vector type V.
+template <int N, class V, class T>
+ANYREF_ALWAYS_INLINE void SimdLoad(V& v, const T* p)
+{
+	SimdVectorT<T, N> t;
+	std::memcpy(&t, p, sizeof(t));
+	v = __builtin_convertvector(t, V);
+}
+//converts the vector v to N elements of T and stores them to p.
+template <int N, class T, class V>
+ANYREF_ALWAYS_INLINE void SimdStore(T* p, const V& v)
+{
+	SimdVectorT<T, N> t = __builtin_convertvector(v, SimdVectorT<T, N>);
+	std::memcpy(p, &t, sizeof(t));
+}
+
+template <class Kernel, class ...Args>
+__attribute__((target("sse2"))) auto RunSSE2(Args ...args) { return Kernel::template Run<16>(args...); }
+template <class Kernel, class ...Args>
+__attribute__((target("avx2"))) auto RunAVX2(Args ...args) { return Kernel::template Run<32>(args...); }
+template <class Kernel, class ...Args>
+__attribute__((target("avx512f,avx512bw,avx512dq,avx512vl"))) auto RunAVX512(Args ...args) { return Kernel::template Run<64>(args...); }
+#endif
+
+template <class Kernel, class ...Args>
+auto DispatchSimd(Args ...args)
+{
+#if ANYREF_SIMD
+	if constexpr (Kernel::Vectorizable)
+	{
+		switch (GetSimdLevel())
+		{
+		case SimdLevel::AVX512: return RunAVX512<Kernel>(args...);
+		case SimdLevel::AVX2: return RunAVX2<Kernel>(args...);
+		case SimdLevel::SSE2: return RunSSE2<Kernel>(args...);
+		default: break;
+		}
+	}
+#endif
+	return Kernel::template Run<0>(args...);
+}
+
+//The arithmetic types are identified by their index in ArithmeticTypes (the "tag").
+//-1 means a non-arithmetic type.
+using ArithmeticTypes = std::tuple<bool, char, signed char, unsigned char, wchar_t, char16_t, char32_t,
+								   short, unsigned short, int, unsigned int, long, unsigned long, long long, unsigned long long,
+								   float, double, long double>;
+template <class T, class Types, int Index = 0>
+struct TagOf;
+template <class T, int Index>
+struct TagOf<T, std::tuple<>, Index> : std::integral_constant<int, -1> {};
+template <class T, class Head, class ...Tail, int Index>
+struct TagOf<T, std::tuple<Head, Tail...>, Index>
+	: std::conditional_t<std::is_same_v<T, Head>, std::integral_constant<int, Index>, TagOf<T, std::tuple<Tail...>, Index + 1>>
+{};
+template <class T>
+inline constexpr int ArithmeticTagV = TagOf<RemoveCVRefT<T>, ArithmeticTypes>::value;
+
+template <class To, class From>
+To ConvertArithmetic(const void* src)
+{
+	return static_cast<To>(*static_cast<const From*>(src));
+}
+template <class To, class From>
+struct ConvertKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<To> && IsSimdElementV<From>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE void Run(const From* src, To* dst, std::size_t size)
+	{
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		if constexpr (Width > 0)
+		{
+			constexpr int N = SimdLanes<Width, To, From>();
+			SimdVectorT<To, N> v;
+			for (const std::size_t end = size / N * N; i < end; i += N)
+			{
+				SimdLoad<N>(v, src + i);
+				SimdStore<N>(dst + i, v);
+			}
+		}
+#endif
+		for (; i < size; ++i) dst[i] = static_cast<To>(src[i]);
+	}
+};
+template <class To, class From>
+void ConvertArithmeticArray(const void* src, To* dst, std::size_t size)
+{
+	DispatchSimd<ConvertKernel<To, From>>(static_cast<const From*>(src), dst, size);
+}
+//ConversionTable<To>::Scalar[tag] converts the value of type ArithmeticTypes[tag] to To,
+//so that the conversion from any arithmetic type costs only one indexed load.
+template <class To, class Types = ArithmeticTypes>
+struct ConversionTable;
+template <class To, class ...Types>
+struct ConversionTable<To, std::tuple<Types...>>
+{
+	static constexpr To(*Scalar[])(const void*) = { &ConvertArithmetic<To, Types>... };
+	static constexpr void(*Array[])(const void*, To*, std::size_t) = { &ConvertArithmeticArray<To, Types>... };
+};
+
+//distinguishes T&, const T&, T&&, ... so that an upcast does not change the kind of reference.
+template <class T>
+inline constexpr int RefKindV = (std::is_lvalue_reference_v<T> ? 1 : std::is_rvalue_reference_v<T> ? 2 : 0) |
+								(std::is_const_v<std::remove_reference_t<T>> ? 4 : 0) |
+								(std::is_volatile_v<std::remove_reference_t<T>> ? 8 : 0);
+//true if AnyURef::Get<Type>/Is<Type> may look for Type among the base classes of the referenced object.
+template <class Type>
+inline constexpr bool IsUpcastTargetV = std::is_reference_v<Type> && std::is_class_v<RemoveCVRefT<Type>>;
+//false if the non-polymorphic class T may have virtual base classes, whose positions depend on the complete object.
+//A class with a virtual base class is neither trivially copyable, an aggregate nor standard-layout, and a final class is always complete.
+template <class T>
+inline constexpr bool HasFixedLayoutV = std::is_polymorphic_v<T> || std::is_final_v<T> || std::is_trivially_copyable_v<T> ||
+										std::is_aggregate_v<T> || std::is_standard_layout_v<T>;
+
+#if ANYREF_EXCEPTIONS
+
+//true if the class has a virtual base class. Without the ABI of libstdc++ to inspect the type_info, assumes that it has.
+inline bool HasVirtualBase(const std::type_info& type)
+{
+#if defined(__GLIBCXX__)
+	if (auto si = dynamic_cast<const abi::__si_class_type_info*>(&type)) return HasVirtualBase(*si->__base_type);
+	if (auto vmi = dynamic_cast<const abi::__vmi_class_type_info*>(&type))
+	{
+		for (unsigned int i = 0; i < vmi->__base_count; ++i)
+		{
+			if (vmi->__base_info[i].__offset_flags & abi::__base_class_type_info::__virtual_mask) return true;
+			if (HasVirtualBase(*vmi->__base_info[i].__base_type)) return true;
+		}
+	}
+	return false;
+#else
+	(void)type;
+	return true;
+#endif
+}
+
+//UpcastCache<Base> maps (static type, dynamic type, offset from the complete object) of referenced objects
+//to the offset of their Base subobject. The offset from the complete object tells apart the subobjects of the same type
+//in a complete object, which may reach a virtual base class at different offsets.
+//The first query for each key computes the offset by throwing the pointer to the object and catching it as Base*,
+//which is the only way to convert a pointer to Base* without knowing its type at compile time.
+//After that, the lookup is lock-free: the table is an open addressing hash table of atomic pointers to immutable entries,
+//which are never removed. When the probe sequence of an entry is full, it goes to the next table of twice the size,
+//so that the cache never refuses an entry and each key is computed only once (unless threads race for it).
+template <class Base>
+class UpcastCache
+{
+public:
+
+	struct Entry
+	{
+		const std::type_info* mStaticType;
+		const std::type_info* mDynamicType;
+		std::ptrdiff_t mTopOffset;
+		std::ptrdiff_t mOffset;
+		bool mIsBase;//false if Base is not an unambiguous public base class.
+	};
+
+	static const Entry* Find(const std::type_info* static_type, const std::type_info* dynamic_type, std::ptrdiff_t top_offset)
+	{
+		std::size_t h = Hash(static_type, dynamic_type, top_offset);
+		for (const Table* t = msFirst.load(std::memory_order_acquire); t != nullptr; t = t->mNext.load(std::memory_order_acquire))
+		{
+			for (std::size_t i = 0; i < MaxProbe; ++i)
+			{
+				const Entry* e = t->mSlots[(h + i) & (t->mSize - 1)].load(std::memory_order_acquire);
+				//an entry goes to the next table only if its probe sequence here is full.
+				if (e == nullptr) return nullptr;
+				if (e->mStaticType == static_type && e->mDynamicType == dynamic_type && e->mTopOffset == top_offset) return e;
+			}
+		}
+		return nullptr;
+	}
+	//does nothing if the cache already has the entry for the same key (inserted by another thread).
+	static void Insert(const Entry& entry)
+	{
+		const Entry* n = new Entry(entry);
+		std::size_t h = Hash(entry.mStaticType, entry.mDynamicType, entry.mTopOffset);
+		for (Table* t = GetNext(msFirst, InitialSize); ; t = GetNext(t->mNext, t->mSize * 2))
+		{
+			for (std::size_t i = 0; i < MaxProbe; ++i)
+			{
+				const Entry* e = nullptr;
+				if (t->mSlots[(h + i) & (t->mSize - 1)].compare_exchange_strong(e, n, std::memory_order_acq_rel, std::memory_order_acquire)) return;
+				if (e->mStaticType == entry.mStaticType && e->mDynamicType == entry.mDynamicType && e->mTopOffset == entry.mTopOffset)
+				{
+					delete n;
+					return;
+				}
+			}
+		}
+	}
+
+private:
+
+	static constexpr std::size_t InitialSize = 256;
+	static constexpr std::size_t MaxProbe = 16;
+
+	struct Table
+	{
+		explicit Table(std::size_t size)
+			: mSize(size), mSlots(new std::atomic<const Entry*>[size]())
+		{}
+		std::size_t mSize;
+		std::unique_ptr<std::atomic<const Entry*>[]> mSlots;
+		std::atomic<Table*> mNext{ nullptr };
+	};
+
+	//returns the table pointed by "link", creating it if it does not exist yet.
+	static Table* GetNext(std::atomic<Table*>& link, std::size_t size)
+	{
+		Table* t = link.load(std::memory_order_acquire);
+		if (t != nullptr) return t;
+		Table* n = new Table(size);
+		if (link.compare_exchange_strong(t, n, std::memory_order_acq_rel, std::memory_order_acquire)) return n;
+		delete n;
+		return t;
+	}
+
+	static std::size_t Hash(const std::type_info* static_type, const std::type_info* dynamic_type, std::ptrdiff_t top_offset)
+	{
+		std::uintptr_t a = reinterpret_cast<std::uintptr_t>(static_type);
+		std::uintptr_t b = reinterpret_cast<std::uintptr_t>(dynamic_type);
+		std::uintptr_t c = static_cast<std::uintptr_t>(top_offset);
+		return static_cast<std::size_t>((((a >> 4) * 31 + (b >> 4)) * 31 + c) * 0x9e3779b97f4a7c15ull >> 32);
+	}
+
+	inline static std::atomic<Table*> msFirst{ nullptr };
+};
+#endif
+
 template <class Refs, class Visitors>
 class Generics_impl;
 
@@ -58,6 +401,28 @@ protected:
 	public:
 		virtual void CopyTo(void* b) const = 0;
 		virtual std::type_index GetTypeIndex() const = 0;
+		//returns the address of the referenced object and sets its arithmetic tag to "tag".
+		virtual const void* GetArithmetic(int& tag) const = 0;
+		//if the referenced object is a contiguous container of arithmetic values,
+		//returns data() and sets the tag of the elements to "tag" and size() to "size".
+		//Otherwise, returns nullptr and sets -1 to "tag".
+		virtual const void* GetArithmeticArray(int& tag, std::size_t& size) const = 0;
+
+		struct ObjectInfo
+		{
+			const void* mAddress;
+			const std::type_info* mStaticType;
+			const std::type_info* mDynamicType;//differs from mStaticType if the object is polymorphic and more derived.
+			std::ptrdiff_t mTopOffset;//the offset from the complete object if the object is polymorphic, otherwise 0.
+			int mRefKind;
+			bool mFixedLayout;//see detail::HasFixedLayoutV.
+		};
+		//mRefKind is -1 if the referenced object is not of a class type, which cannot be upcast.
+		virtual ObjectInfo GetObjectInfo() const = 0;
+#if ANYREF_EXCEPTIONS
+		//throws the pointer to the referenced object, so that it can be caught as a pointer to its base class.
+		virtual void ThrowPointer() const = 0;
+#endif
 	};
 
 	template <class T>
@@ -72,6 +437,58 @@ protected:
 			new (ptr) Holder<T>(*this);
 		}
 		virtual std::type_index GetTypeIndex() const { return typeid(T); }
+		virtual const void* GetArithmetic(int& tag) const
+		{
+			using Type = std::remove_reference_t<T>;
+			if constexpr (std::is_function_v<Type>)
+			{
+				tag = -1;
+				return nullptr;
+			}
+			else
+			{
+				//a volatile object is not regarded as arithmetic, since GetAs reads it through a non-volatile pointer.
+				tag = std::is_volatile_v<Type> ? -1 : detail::ArithmeticTagV<T>;
+				return const_cast<const void*>(static_cast<const volatile void*>(std::addressof(mValue)));
+			}
+		}
+		virtual const void* GetArithmeticArray(int& tag, std::size_t& size) const
+		{
+			//a volatile container is not regarded as arithmetic, as in GetArithmetic.
+			if constexpr (detail::IsArithmeticArrayV<T> && !std::is_volatile_v<std::remove_reference_t<T>>)
+			{
+				tag = detail::ArithmeticTagV<std::remove_pointer_t<decltype(mValue.data())>>;
+				size = mValue.size();
+				return mValue.data();
+			}
+			else
+			{
+				tag = -1;
+				size = 0;
+				return nullptr;
+			}
+		}
+		virtual ObjectInfo GetObjectInfo() const
+		{
+			using Type = std::remove_cv_t<std::remove_reference_t<T>>;
+			if constexpr (std::is_class_v<Type>)
+			{
+				const volatile void* p = std::addressof(mValue);
+				std::ptrdiff_t top = 0;
+				if constexpr (std::is_polymorphic_v<Type>)
+				{
+					top = static_cast<const volatile char*>(p) - static_cast<const volatile char*>(dynamic_cast<const volatile void*>(std::addressof(mValue)));
+				}
+				return { const_cast<const void*>(p), &typeid(T), &typeid(mValue), top, detail::RefKindV<T>, detail::HasFixedLayoutV<Type> };
+			}
+			else return { nullptr, nullptr, nullptr, 0, -1, true };
+		}
+#if ANYREF_EXCEPTIONS
+		virtual void ThrowPointer() const
+		{
+			if constexpr (std::is_class_v<std::remove_reference_t<T>>) throw std::addressof(mValue);
+		}
+#endif
 		T mValue;
 	};
 
@@ -120,10 +537,27 @@ public:
 		return *this;
 	}
 
+	//If Type is a reference to a class, Get and Is also accept a reference to a class derived from it,
+	//e.g. Get<const Base&>() on a reference to const Derived.
+	//The offset of the base class subobject is cached per pair of the referenced type and Type (see detail::UpcastCache),
+	//so that it costs only one hashed lookup except the first time. This is disabled when ANYREF_EXCEPTIONS is 0.
+	//The offset of a virtual base class of a non-polymorphic referenced type is not cached, since it depends on the complete object,
+	//so such a query throws and catches every time.
 	template <class Type>
 	Type Get() const
 	{
 		const Holder<Type>* p = GetHolder<Type>();
+#if ANYREF_EXCEPTIONS
+		if constexpr (detail::IsUpcastTargetV<Type>)
+		{
+			if (p == nullptr)
+			{
+				const void* q = GetUpcast<Type>();
+				assert(q != nullptr);
+				return static_cast<Type>(*static_cast<std::remove_reference_t<Type>*>(const_cast<void*>(q)));
+			}
+		}
+#endif
 		assert(p != nullptr);
 		return static_cast<Type>(p->mValue);
 	}
@@ -131,7 +565,11 @@ public:
 	template <class Type>
 	bool Is() const
 	{
-		return GetHolder<Type>() != nullptr;
+		if (GetHolder<Type>() != nullptr) return true;
+#if ANYREF_EXCEPTIONS
+		if constexpr (detail::IsUpcastTargetV<Type>) return GetUpcast<Type>() != nullptr;
+#endif
+		return false;
 	}
 
 	std::type_index GetTypeIndex() const
@@ -139,14 +577,108 @@ public:
 		return GetHolderBase()->GetTypeIndex();
 	}
 
+	//GetAs, TryGetAs and GetArrayAs convert the referenced arithmetic value(s) to Type
+	//regardless of the original arithmetic type, e.g. GetAs<double>() on a reference to int.
+	bool IsArithmetic() const
+	{
+		int tag;
+		GetHolderBase()->GetArithmetic(tag);
+		return tag >= 0;
+	}
+	template <class Type>
+	Type GetAs() const
+	{
+		static_assert(std::is_arithmetic_v<Type>, "Type must be an arithmetic type.");
+		int tag;
+		const void* p = GetHolderBase()->GetArithmetic(tag);
+		assert(tag >= 0);
+		return detail::ConversionTable<Type>::Scalar[tag](p);
+	}
+	template <class Type>
+	std::optional<Type> TryGetAs() const
+	{
+		static_assert(std::is_arithmetic_v<Type>, "Type must be an arithmetic type.");
+		int tag;
+		const void* p = GetHolderBase()->GetArithmetic(tag);
+		if (tag < 0) return std::nullopt;
+		return detail::ConversionTable<Type>::Scalar[tag](p);
+	}
+
+	//true if the referenced object is a contiguous container of arithmetic values (std::vector<int>, std::array<float, N>, ...).
+	bool IsArithmeticArray() const
+	{
+		int tag;
+		std::size_t size;
+		GetHolderBase()->GetArithmeticArray(tag, size);
+		return tag >= 0;
+	}
+	//returns 0 if the referenced object is not a contiguous container of arithmetic values.
+	std::size_t GetArraySize() const
+	{
+		int tag;
+		std::size_t size;
+		GetHolderBase()->GetArithmeticArray(tag, size);
+		return size;
+	}
+	//converts the first min(size, GetArraySize()) elements of the referenced container to Type,
+	//stores them into buffer, and returns the number of the converted elements.
+	template <class Type>
+	std::size_t GetArrayAs(Type* buffer, std::size_t size) const
+	{
+		static_assert(std::is_arithmetic_v<Type>, "Type must be an arithmetic type.");
+		int tag;
+		std::size_t n;
+		const void* p = GetHolderBase()->GetArithmeticArray(tag, n);
+		assert(tag >= 0);
+		if (n > size) n = size;
+		detail::ConversionTable<Type>::Array[tag](p, buffer, n);
+		return n;
+	}
+
 private:
 
 	template <class Type>
 	const Holder<Type>* GetHolder() const
 	{
+		//Holder<T> is always the most derived type, so comparing typeid is enough and,
+		//unlike a failing dynamic_cast, does not walk the class hierarchy.
 		const HolderBase* p = reinterpret_cast<const HolderBase*>(&mStorage);
-		return dynamic_cast<const Holder<Type>*>(p);
+		return typeid(*p) == typeid(Holder<Type>) ? static_cast<const Holder<Type>*>(p) : nullptr;
 	}
+#if ANYREF_EXCEPTIONS
+	//returns the address of the Base subobject of the referenced object, or nullptr if it is not derived from Base.
+	template <class Type, class Base = detail::RemoveCVRefT<Type>>
+	const void* GetUpcast() const
+	{
+		HolderBase::ObjectInfo info = GetHolderBase()->GetObjectInfo();
+		if (info.mRefKind != detail::RefKindV<Type>) return nullptr;
+		const typename detail::UpcastCache<Base>::Entry* e = detail::UpcastCache<Base>::Find(info.mStaticType, info.mDynamicType, info.mTopOffset);
+		if (e == nullptr) return FillUpcastCache<Base>(info);
+		return e->mIsBase ? static_cast<const char*>(info.mAddress) + e->mOffset : nullptr;
+	}
+	//the slow path of GetUpcast, which is taken only once for each key of detail::UpcastCache.
+	//It is kept out of line, otherwise the exception handling inflates GetUpcast and makes the cached path several times slower.
+	template <class Base>
+	ANYREF_NOINLINE const void* FillUpcastCache(const HolderBase::ObjectInfo& info) const
+	{
+		typename detail::UpcastCache<Base>::Entry e{ info.mStaticType, info.mDynamicType, info.mTopOffset, 0, false };
+		try
+		{
+			GetHolderBase()->ThrowPointer();
+		}
+		catch (const volatile Base* b)
+		{
+			e.mOffset = reinterpret_cast<const char*>(const_cast<const Base*>(b)) - static_cast<const char*>(info.mAddress);
+			e.mIsBase = true;
+		}
+		catch (...)
+		{}
+		//the result is the same for all objects of the type unless it may go through a virtual base class,
+		//which only a polymorphic type can locate (by mTopOffset).
+		if (!e.mIsBase || info.mFixedLayout || !detail::HasVirtualBase(*info.mStaticType)) detail::UpcastCache<Base>::Insert(e);
+		return e.mIsBase ? static_cast<const char*>(info.mAddress) + e.mOffset : nullptr;
+	}
+#endif
 	const HolderBase* GetHolderBase() const
 	{
 		return reinterpret_cast<const HolderBase*>(&mStorage);
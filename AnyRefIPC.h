@@ -0,0 +1,359 @@
+#ifndef THAYAKAWA_ANYREF_IPC_H
+#define THAYAKAWA_ANYREF_IPC_H
+
+#if !defined(__unix__) && !defined(__APPLE__)
+#error "AnyRefIPC.h requires POSIX shared memory."
+#endif
+
+#include "AnyRef.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace anyref
+{
+
+namespace detail
+{
+
+constexpr std::uint64_t Fnv1a(std::string_view s)
+{
+	std::uint64_t h = 14695981039346656037ull;
+	for (char c : s) h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+	return h;
+}
+template <class T>
+constexpr std::string_view TypeSignature()
+{
+#if defined(_MSC_VER)
+	return __FUNCSIG__;
+#else
+	return __PRETTY_FUNCTION__;
+#endif
+}
+
+struct ShmChannelHeader
+{
+	static constexpr std::uint64_t Magic = 0x414e595245464332ull;//"ANYREFC2"
+	std::atomic<std::uint64_t> mMagic;//set last by the creator, after the initialization.
+	std::uint64_t mCapacity;
+	std::uint64_t mSlotSize;
+	std::uint64_t mProducer;//ShmChannel::ProducerKind of the creator.
+	alignas(64) std::atomic<std::uint64_t> mHead;//next position to be written by the producers.
+	alignas(64) std::atomic<std::uint64_t> mTail;//next position to be read by the consumer.
+};
+//each slot consists of this header and the payload that starts at PayloadOffset.
+struct ShmSlotHeader
+{
+	static constexpr std::size_t PayloadOffset = 64;
+	std::atomic<std::uint64_t> mSequence;
+	std::uint64_t mTypeID;
+	std::uint64_t mSize;
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "64-bit atomics must be lock-free to be shared between processes.");
+
+}
+
+//StableTypeID<T>::value is computed from the name of T at compile time.
+//Unlike std::type_index, it is identical in all processes built by the same compiler.
+//Specialize it to give a type an explicit ID.
+template <class T>
+struct StableTypeID
+{
+	static constexpr std::uint64_t value = detail::Fnv1a(detail::TypeSignature<detail::RemoveCVRefT<T>>());
+};
+template <class T>
+inline constexpr std::uint64_t StableTypeIDV = StableTypeID<T>::value;
+
+struct SingleProducer {};
+struct MultiProducer {};
+
+//Bounded ring buffer on POSIX shared memory, carrying trivially copyable objects of any type
+//tagged with their StableTypeID.
+//Only one process may receive. Producer == SingleProducer also allows only one process to send,
+//MultiProducer allows any number of them.
+//The algorithm is the bounded queue by D. Vyukov: each slot has a sequence number telling
+//whether it is ready to be written or read, so that a received message can be released independently.
+template <class Producer = SingleProducer>
+class ShmChannel
+{
+	static_assert(std::is_same_v<Producer, SingleProducer> || std::is_same_v<Producer, MultiProducer>,
+				  "Producer must be SingleProducer or MultiProducer.");
+
+public:
+
+	//A received message. The payload stays in the ring buffer, and the slot is released when the Message is destroyed.
+	class Message
+	{
+		friend class ShmChannel;
+
+		Message(detail::ShmSlotHeader* slot, std::uint64_t release)
+			: mSlot(slot), mRelease(release)
+		{}
+
+	public:
+
+		Message() : mSlot(nullptr), mRelease(0) {}
+		Message(Message&& m) noexcept
+			: mSlot(m.mSlot), mRelease(m.mRelease)
+		{
+			m.mSlot = nullptr;
+		}
+		Message& operator=(Message&& m) noexcept
+		{
+			if (this != &m)
+			{
+				Release();
+				mSlot = m.mSlot;
+				mRelease = m.mRelease;
+				m.mSlot = nullptr;
+			}
+			return *this;
+		}
+		Message(const Message&) = delete;
+		Message& operator=(const Message&) = delete;
+		~Message() { Release(); }
+
+		explicit operator bool() const { return mSlot != nullptr; }
+
+		std::uint64_t GetTypeID() const { return mSlot->mTypeID; }
+		std::size_t GetSize() const { return static_cast<std::size_t>(mSlot->mSize); }
+		const void* GetData() const { return reinterpret_cast<const char*>(mSlot) + detail::ShmSlotHeader::PayloadOffset; }
+
+		template <class Type>
+		bool Is() const
+		{
+			return mSlot != nullptr && mSlot->mTypeID == StableTypeIDV<Type>;
+		}
+		template <class Type>
+		const Type& Get() const
+		{
+			assert(Is<Type>());
+			return *static_cast<const Type*>(GetData());
+		}
+
+		//returns an AnyCRef to the payload if its type is one of Types, otherwise the null AnyCRef.
+		//The AnyCRef points into the ring buffer, so it must not outlive this Message.
+		template <class ...Types>
+		AnyCRef GetRef() const
+		{
+			AnyCRef res;
+			Apply<Types...>([&res](const auto& v) { res = v; });
+			return res;
+		}
+		//calls f(const T&) with the payload if its type T is one of Types, and returns whether it is called.
+		//Since f receives the concrete type, the payload can be given to Generics directly, e.g.
+		//	msg.Apply<int, double>([](const auto& v) { FuncTakingGenerics(v); });
+		template <class ...Types, class Func>
+		bool Apply(Func&& f) const
+		{
+			return (... || (Is<Types>() ? (f(Get<Types>()), void(), true) : false));
+		}
+
+	private:
+
+		void Release()
+		{
+			if (mSlot != nullptr) mSlot->mSequence.store(mRelease, std::memory_order_release);
+			mSlot = nullptr;
+		}
+
+		detail::ShmSlotHeader* mSlot;
+		std::uint64_t mRelease;
+	};
+
+	//creates a new shared memory object "name" (e.g. "/my_channel") that holds "capacity" messages of up to max_size bytes.
+	//capacity is rounded up to a power of 2. The shared memory object is removed when this ShmChannel is destroyed.
+	//Throws std::system_error if it already exists or cannot be created.
+	ShmChannel(const char* name, std::size_t capacity, std::size_t max_size)
+		: mName(name), mOwner(true)
+	{
+		std::uint64_t cap = 1;
+		while (cap < capacity) cap <<= 1;
+		std::uint64_t slot_size = detail::ShmSlotHeader::PayloadOffset + (max_size + 63) / 64 * 64;
+
+		int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd < 0) throw std::system_error(errno, std::generic_category(), "shm_open");
+		mMappedSize = HeaderSize() + cap * slot_size;
+		if (ftruncate(fd, static_cast<off_t>(mMappedSize)) != 0)
+		{
+			int e = errno;
+			close(fd);
+			shm_unlink(name);
+			throw std::system_error(e, std::generic_category(), "ftruncate");
+		}
+		Map(fd);
+
+		mHeader = new (mMemory) detail::ShmChannelHeader;
+		mHeader->mCapacity = cap;
+		mHeader->mSlotSize = slot_size;
+		mHeader->mProducer = ProducerKind;
+		mHeader->mHead.store(0, std::memory_order_relaxed);
+		mHeader->mTail.store(0, std::memory_order_relaxed);
+		for (std::uint64_t i = 0; i < cap; ++i)
+		{
+			detail::ShmSlotHeader* s = new (GetSlot(i)) detail::ShmSlotHeader;
+			s->mSequence.store(i, std::memory_order_relaxed);
+		}
+		mHeader->mMagic.store(detail::ShmChannelHeader::Magic, std::memory_order_release);
+	}
+	//opens the shared memory object "name" created by another ShmChannel.
+	//Throws std::system_error if it does not exist, is not a ShmChannel, or was created with the other Producer.
+	explicit ShmChannel(const char* name)
+		: mName(name), mOwner(false)
+	{
+		int fd = shm_open(name, O_RDWR, 0600);
+		if (fd < 0) throw std::system_error(errno, std::generic_category(), "shm_open");
+		struct stat st;
+		if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < HeaderSize())
+		{
+			close(fd);
+			throw std::system_error(EINVAL, std::generic_category(), "ShmChannel: invalid shared memory object");
+		}
+		mMappedSize = static_cast<std::size_t>(st.st_size);
+		Map(fd);
+		mHeader = reinterpret_cast<detail::ShmChannelHeader*>(mMemory);
+		//SingleProducer and MultiProducer claim the slots differently, so they cannot share a channel.
+		//The slots must also fit in the mapping, since the header is not trusted.
+		if (mHeader->mMagic.load(std::memory_order_acquire) != detail::ShmChannelHeader::Magic ||
+			mHeader->mProducer != ProducerKind || !IsValidLayout(mHeader->mCapacity, mHeader->mSlotSize, mMappedSize))
+		{
+			munmap(mMemory, mMappedSize);
+			throw std::system_error(EINVAL, std::generic_category(), "ShmChannel: invalid shared memory object");
+		}
+	}
+	ShmChannel(const ShmChannel&) = delete;
+	ShmChannel(ShmChannel&&) = delete;
+	ShmChannel& operator=(const ShmChannel&) = delete;
+	ShmChannel& operator=(ShmChannel&&) = delete;
+	~ShmChannel()
+	{
+		munmap(mMemory, mMappedSize);
+		if (mOwner) shm_unlink(mName.c_str());
+	}
+
+	std::size_t GetCapacity() const { return static_cast<std::size_t>(mHeader->mCapacity); }
+	std::size_t GetMaxSize() const { return static_cast<std::size_t>(mHeader->mSlotSize - detail::ShmSlotHeader::PayloadOffset); }
+
+	//copies v into the ring buffer. Returns false if the buffer is full.
+	//Throws std::length_error if sizeof(Type) exceeds GetMaxSize(), which is checked in all builds
+	//because max_size is given at runtime and a larger payload would overwrite the next slot.
+	template <class Type>
+	bool TrySend(const Type& v)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>, "only trivially copyable types can be sent.");
+		static_assert(alignof(Type) <= detail::ShmSlotHeader::PayloadOffset, "the alignment of Type is too large.");
+		if (sizeof(Type) > GetMaxSize()) throw std::length_error("ShmChannel: the message is larger than max_size");
+		std::uint64_t pos;
+		detail::ShmSlotHeader* slot = Claim(pos);
+		if (slot == nullptr) return false;
+		std::memcpy(reinterpret_cast<char*>(slot) + detail::ShmSlotHeader::PayloadOffset, &v, sizeof(Type));
+		slot->mTypeID = StableTypeIDV<Type>;
+		slot->mSize = sizeof(Type);
+		slot->mSequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+	//waits until the buffer has a free slot. Throws std::length_error as TrySend does.
+	template <class Type>
+	void Send(const Type& v)
+	{
+		while (!TrySend(v)) std::this_thread::yield();
+	}
+
+	//returns the empty Message if the buffer is empty.
+	Message TryReceive()
+	{
+		std::uint64_t pos = mHeader->mTail.load(std::memory_order_relaxed);
+		detail::ShmSlotHeader* slot = GetSlot(pos);
+		std::uint64_t seq = slot->mSequence.load(std::memory_order_acquire);
+		if (seq != pos + 1) return Message();
+		mHeader->mTail.store(pos + 1, std::memory_order_relaxed);
+		return Message(slot, pos + mHeader->mCapacity);
+	}
+	//waits until a message arrives.
+	Message Receive()
+	{
+		for (;;)
+		{
+			if (Message m = TryReceive()) return m;
+			std::this_thread::yield();
+		}
+	}
+
+private:
+
+	static constexpr std::uint64_t ProducerKind = std::is_same_v<Producer, MultiProducer> ? 1 : 0;
+
+	static constexpr std::size_t HeaderSize() { return (sizeof(detail::ShmChannelHeader) + 63) / 64 * 64; }
+	static bool IsValidLayout(std::uint64_t cap, std::uint64_t slot_size, std::size_t mapped_size)
+	{
+		return cap != 0 && (cap & (cap - 1)) == 0 &&
+			   slot_size >= detail::ShmSlotHeader::PayloadOffset && slot_size % 64 == 0 &&
+			   cap <= (mapped_size - HeaderSize()) / slot_size;
+	}
+
+	void Map(int fd)
+	{
+		void* p = mmap(nullptr, mMappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		int e = errno;
+		close(fd);
+		if (p == MAP_FAILED)
+		{
+			if (mOwner) shm_unlink(mName.c_str());
+			throw std::system_error(e, std::generic_category(), "mmap");
+		}
+		mMemory = p;
+	}
+	detail::ShmSlotHeader* GetSlot(std::uint64_t pos) const
+	{
+		char* slots = static_cast<char*>(mMemory) + HeaderSize();
+		return reinterpret_cast<detail::ShmSlotHeader*>(slots + (pos & (mHeader->mCapacity - 1)) * mHeader->mSlotSize);
+	}
+	//reserves the slot at the head and stores its position to pos. Returns nullptr if the buffer is full.
+	detail::ShmSlotHeader* Claim(std::uint64_t& pos)
+	{
+		pos = mHeader->mHead.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			detail::ShmSlotHeader* slot = GetSlot(pos);
+			std::uint64_t seq = slot->mSequence.load(std::memory_order_acquire);
+			std::int64_t diff = static_cast<std::int64_t>(seq - pos);
+			if (diff < 0) return nullptr;
+			if (diff == 0)
+			{
+				if constexpr (std::is_same_v<Producer, SingleProducer>)
+				{
+					mHeader->mHead.store(pos + 1, std::memory_order_relaxed);
+					return slot;
+				}
+				else
+				{
+					if (mHeader->mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return slot;
+					//pos has been updated by compare_exchange_weak.
+				}
+			}
+			else pos = mHeader->mHead.load(std::memory_order_relaxed);
+		}
+	}
+
+	std::string mName;
+	bool mOwner;
+	void* mMemory = nullptr;
+	std::size_t mMappedSize = 0;
+	detail::ShmChannelHeader* mHeader = nullptr;
+};
+
+}
+
+#endif
@@ -0,0 +1,457 @@
+#ifndef THAYAKAWA_ANYREF_KERNELS_H
+#define THAYAKAWA_ANYREF_KERNELS_H
+
+#include "AnyRef.h"
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+namespace anyref
+{
+
+namespace detail
+{
+
+//The kernels below work on raw pointers and are dispatched by DispatchSimd (see AnyRef.h).
+//Run<0> is the scalar version, used for the element types that cannot be vectorized (bool, long double)
+//and when ANYREF_SIMD is 0. Run<Width> processes a vector of Width bytes at once and leaves the remainder to the scalar loop
+//(see SimdLanes in AnyRef.h for the number of elements processed at once).
+//Note that the vectorized reductions add the elements in a different order, so the floating point results
+//may differ slightly between the instruction sets.
+template <class R, class T>
+struct SumKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE R Run(const T* p, std::size_t n)
+	{
+		R res = R();
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		if constexpr (Width > 0)
+		{
+			constexpr int N = SimdLanes<Width, R, T>();
+			using V = SimdVectorT<R, N>;
+			V a0 = {}, a1 = {}, v0, v1;
+			for (const std::size_t end = n / (2 * N) * (2 * N); i < end; i += 2 * N)
+			{
+				SimdLoad<N>(v0, p + i);
+				SimdLoad<N>(v1, p + i + N);
+				a0 += v0;
+				a1 += v1;
+			}
+			a0 += a1;
+			for (int k = 0; k < N; ++k) res += a0[k];
+		}
+#endif
+		for (; i < n; ++i) res += static_cast<R>(p[i]);
+		return res;
+	}
+};
+template <class R, class T>
+struct MinMaxKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE std::pair<R, R> Run(const T* p, std::size_t n)
+	{
+		R mn = std::numeric_limits<R>::max(), mx = std::numeric_limits<R>::lowest();
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		if constexpr (Width > 0)
+		{
+			constexpr int N = SimdLanes<Width, R, T>();
+			using V = SimdVectorT<R, N>;
+			V vmn = V{} + mn, vmx = V{} + mx, v;
+			for (const std::size_t end = n / N * N; i < end; i += N)
+			{
+				SimdLoad<N>(v, p + i);
+				vmn = v < vmn ? v : vmn;
+				vmx = v > vmx ? v : vmx;
+			}
+			for (int k = 0; k < N; ++k)
+			{
+				mn = vmn[k] < mn ? vmn[k] : mn;
+				mx = vmx[k] > mx ? vmx[k] : mx;
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			R v = static_cast<R>(p[i]);
+			mn = v < mn ? v : mn;
+			mx = v > mx ? v : mx;
+		}
+		return { mn, mx };
+	}
+};
+template <class R, class T, class U>
+struct DotKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T> && IsSimdElementV<U>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE R Run(const T* x, const U* y, std::size_t n)
+	{
+		R res = R();
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		if constexpr (Width > 0)
+		{
+			constexpr int N = SimdLanes<Width, R, T, U>();
+			using V = SimdVectorT<R, N>;
+			V a0 = {}, a1 = {}, x0, x1, y0, y1;
+			for (const std::size_t end = n / (2 * N) * (2 * N); i < end; i += 2 * N)
+			{
+				SimdLoad<N>(x0, x + i);
+				SimdLoad<N>(y0, y + i);
+				SimdLoad<N>(x1, x + i + N);
+				SimdLoad<N>(y1, y + i + N);
+				a0 += x0 * y0;
+				a1 += x1 * y1;
+			}
+			a0 += a1;
+			for (int k = 0; k < N; ++k) res += a0[k];
+		}
+#endif
+		for (; i < n; ++i) res += static_cast<R>(x[i]) * static_cast<R>(y[i]);
+		return res;
+	}
+};
+template <class R, class T, class U>
+struct AxpyKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T> && IsSimdElementV<U>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE void Run(R a, const T* x, U* y, std::size_t n)
+	{
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		if constexpr (Width > 0)
+		{
+			constexpr int N = SimdLanes<Width, R, T, U>();
+			using V = SimdVectorT<R, N>;
+			V va = V{} + a, vx, vy;
+			for (const std::size_t end = n / N * N; i < end; i += N)
+			{
+				SimdLoad<N>(vx, x + i);
+				SimdLoad<N>(vy, y + i);
+				vy += va * vx;
+				SimdStore<N>(y + i, vy);
+			}
+		}
+#endif
+		for (; i < n; ++i) y[i] = static_cast<U>(static_cast<R>(y[i]) + a * static_cast<R>(x[i]));
+	}
+};
+template <class R, class T>
+struct ScaleKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE void Run(R a, T* p, std::size_t n)
+	{
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		if constexpr (Width > 0)
+		{
+			constexpr int N = SimdLanes<Width, R, T>();
+			using V = SimdVectorT<R, N>;
+			V va = V{} + a, v;
+			for (const std::size_t end = n / N * N; i < end; i += N)
+			{
+				SimdLoad<N>(v, p + i);
+				v *= va;
+				SimdStore<N>(p + i, v);
+			}
+		}
+#endif
+		for (; i < n; ++i) p[i] = static_cast<T>(static_cast<R>(p[i]) * a);
+	}
+};
+template <class R, class T>
+struct MaskKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE std::size_t Run(R lo, R hi, const T* p, unsigned char* mask, std::size_t n)
+	{
+		std::size_t count = 0;
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		//GCC splits a comparison of vectors into scalars unless it fits one register,
+		//and it does so for 64-byte ones in any case, so the AVX-512 build compares 32 bytes at a time.
+		//with less than 4 elements per register, the conversion and the byte stores cost more than the scalar loop.
+		constexpr int N = (Width > 32 ? 32 : Width) / static_cast<int>(sizeof(R));
+		if constexpr (N >= 4)
+		{
+			using V = SimdVectorT<R, N>;
+			V vlo = V{} + lo, vhi = V{} + hi, v;
+			//the comparison of vectors gives -1 for true and 0 for false in each element.
+			using M = decltype(vlo < vhi);
+			//the elements of M are as wide as R, so vcount is added to count before it can overflow.
+			using L = std::remove_cv_t<std::remove_reference_t<decltype(std::declval<M&>()[0])>>;
+			constexpr std::size_t Flush = std::min<std::size_t>(std::numeric_limits<L>::max(), 1 << 16);
+			for (const std::size_t end = n / N * N; i < end;)
+			{
+				M vcount = {}, m;
+				for (const std::size_t block_end = std::min(end, i + Flush * N); i < block_end; i += N)
+				{
+					SimdLoad<N>(v, p + i);
+					m = (vlo <= v) & (v < vhi);
+					vcount -= m;
+					m = -m;
+					SimdStore<N>(mask + i, m);
+				}
+				for (int k = 0; k < N; ++k) count += static_cast<std::size_t>(static_cast<std::make_unsigned_t<L>>(vcount[k]));
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			R v = static_cast<R>(p[i]);
+			unsigned char m = static_cast<unsigned char>((lo <= v) & (v < hi));
+			mask[i] = m;
+			count += m;
+		}
+		return count;
+	}
+};
+
+#if ANYREF_SIMD
+//adds -m[k] (1 or 0) to bins[index[k]] for each element. Unrolling it lets the elements be read from registers.
+template <class M, std::size_t ...K>
+ANYREF_ALWAYS_INLINE void AddToBins(std::size_t* bins, const M& index, const M& m, std::index_sequence<K...>)
+{
+	((bins[index[K]] += static_cast<std::size_t>(-m[K])), ...);
+}
+#endif
+//F is the floating point type in which the position in the bins is computed.
+//Only the positions are vectorized; the bins are still incremented one by one, so the gain is smaller than the other kernels.
+template <class R, class F, class T>
+struct HistogramKernel
+{
+	static constexpr bool Vectorizable = IsSimdElementV<R> && IsSimdElementV<T>;
+	template <int Width>
+	static ANYREF_ALWAYS_INLINE void Run(F lo, F scale, F nbins, const T* p, std::size_t* bins, std::size_t n)
+	{
+		std::size_t i = 0;
+#if ANYREF_SIMD
+		//the comparisons are limited to one register as in MaskKernel.
+		constexpr int N = (Width > 32 ? 32 : Width) / static_cast<int>(sizeof(F));
+		if constexpr (N >= 4)
+		{
+			using V = SimdVectorT<F, N>;
+			V vlo = V{} + lo, vscale = V{} + scale, vnbins = V{} + nbins, t;
+			SimdVectorT<R, N> v;
+			using M = decltype(vlo < vnbins);
+			M m, index;
+			for (const std::size_t end = n / N * N; i < end; i += N)
+			{
+				SimdLoad<N>(v, p + i);
+				t = (__builtin_convertvector(v, V) - vlo) * vscale;
+				m = (t >= V{}) & (t < vnbins);
+				//the elements out of range add 0 to bins[0].
+				index = __builtin_convertvector(m ? t : V{}, M);
+				AddToBins(bins, index, m, std::make_index_sequence<N>());
+			}
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			F t = (static_cast<F>(static_cast<R>(p[i])) - lo) * scale;
+			if (t >= F() && t < nbins) ++bins[static_cast<std::size_t>(t)];
+		}
+	}
+};
+
+//the type of the elements of a contiguous container.
+template <class Container>
+using ElementT = std::remove_cv_t<std::remove_pointer_t<decltype(std::declval<const Container&>().data())>>;
+
+}
+
+//Built-in visitors for containers of arithmetic values, e.g.
+//	Generics<AnyCRef, std::tuple<Sum<>, MinMax<>>> g(std::vector<float>{ ... });
+//Containers that store their elements contiguously (std::vector, std::array, std::basic_string, ...)
+//are processed by the SSE2/AVX2/AVX-512 kernels in detail chosen at runtime, the others (std::list, std::deque, ...)
+//by plain iterator loops.
+//R is the type used for the arithmetic and the result; each element is converted to R before use.
+
+template <class R = double>
+struct Sum
+{
+	using ArgTypes = std::tuple<>;
+	using RetType = R;
+	template <class Container>
+	R operator()(const Container& c) const
+	{
+		if constexpr (detail::IsArithmeticArrayV<Container>) return detail::DispatchSimd<detail::SumKernel<R, detail::ElementT<Container>>>(c.data(), c.size());
+		else
+		{
+			R res = R();
+			for (const auto& v : c) res += static_cast<R>(v);
+			return res;
+		}
+	}
+};
+
+//returns { min, max }. If the container is empty, { numeric_limits<R>::max(), numeric_limits<R>::lowest() }.
+template <class R = double>
+struct MinMax
+{
+	using ArgTypes = std::tuple<>;
+	using RetType = std::pair<R, R>;
+	template <class Container>
+	std::pair<R, R> operator()(const Container& c) const
+	{
+		if constexpr (detail::IsArithmeticArrayV<Container>) return detail::DispatchSimd<detail::MinMaxKernel<R, detail::ElementT<Container>>>(c.data(), c.size());
+		else
+		{
+			std::pair<R, R> res(std::numeric_limits<R>::max(), std::numeric_limits<R>::lowest());
+			for (const auto& v : c)
+			{
+				R r = static_cast<R>(v);
+				if (r < res.first) res.first = r;
+				if (r > res.second) res.second = r;
+			}
+			return res;
+		}
+	}
+};
+
+//Generics<std::tuple<AnyCRef, AnyCRef>, Dot<>>
+//Both containers must have the same size.
+template <class R = double>
+struct Dot
+{
+	using ArgTypes = std::tuple<>;
+	using RetType = R;
+	template <class Container1, class Container2>
+	R operator()(const Container1& x, const Container2& y) const
+	{
+		assert(std::size(x) == std::size(y));
+		if constexpr (detail::IsArithmeticArrayV<Container1> && detail::IsArithmeticArrayV<Container2>)
+			return detail::DispatchSimd<detail::DotKernel<R, detail::ElementT<Container1>, detail::ElementT<Container2>>>(
+				x.data(), y.data(), x.size());
+		else
+		{
+			R res = R();
+			auto it = std::begin(y);
+			for (const auto& v : x) res += static_cast<R>(v) * static_cast<R>(*it++);
+			return res;
+		}
+	}
+};
+
+//y += a * x.
+//Generics<std::tuple<AnyCRef, AnyRef>, Axpy<>>, and Visit<0>(a).
+template <class R = double>
+struct Axpy
+{
+	using ArgTypes = std::tuple<R>;
+	using RetType = void;
+	template <class Container1, class Container2>
+	void operator()(R a, const Container1& x, Container2& y) const
+	{
+		assert(std::size(x) == std::size(y));
+		if constexpr (detail::IsArithmeticArrayV<Container1> && detail::IsArithmeticArrayV<Container2>)
+			detail::DispatchSimd<detail::AxpyKernel<R, detail::ElementT<Container1>, detail::ElementT<Container2>>>(
+				a, x.data(), y.data(), x.size());
+		else
+		{
+			auto it = std::begin(x);
+			for (auto& v : y)
+			{
+				using Elem = std::decay_t<decltype(v)>;
+				v = static_cast<Elem>(v + a * static_cast<R>(*it++));
+			}
+		}
+	}
+};
+
+//v *= a.
+//Generics<AnyRef, Scale<>>, and Visit<0>(a).
+template <class R = double>
+struct Scale
+{
+	using ArgTypes = std::tuple<R>;
+	using RetType = void;
+	template <class Container>
+	void operator()(R a, Container& c) const
+	{
+		if constexpr (detail::IsArithmeticArrayV<Container>) detail::DispatchSimd<detail::ScaleKernel<R, detail::ElementT<Container>>>(a, c.data(), c.size());
+		else
+		{
+			for (auto& v : c)
+			{
+				using Elem = std::decay_t<decltype(v)>;
+				v = static_cast<Elem>(v * a);
+			}
+		}
+	}
+};
+
+//Visit<0>(lo, hi, bins) divides [lo, hi) into bins.size() bins of equal width
+//and adds the number of elements in each bin to bins. The elements outside of [lo, hi) are ignored.
+template <class R = double>
+struct Histogram
+{
+	using ArgTypes = std::tuple<R, R, std::vector<std::size_t>&>;
+	using RetType = void;
+	template <class Container>
+	void operator()(R lo, R hi, std::vector<std::size_t>& bins, const Container& c) const
+	{
+		if (bins.empty()) return;
+		//the position in the bins is computed in floating point even if R is an integer.
+		using F = std::conditional_t<std::is_floating_point_v<R>, R, double>;
+		const F nbins = static_cast<F>(bins.size());
+		const F flo = static_cast<F>(lo);
+		const F scale = nbins / (static_cast<F>(hi) - flo);
+		if constexpr (detail::IsArithmeticArrayV<Container>)
+		{
+			detail::DispatchSimd<detail::HistogramKernel<R, F, detail::ElementT<Container>>>(flo, scale, nbins, c.data(), bins.data(), c.size());
+		}
+		else
+		{
+			for (const auto& v : c)
+			{
+				F t = (static_cast<F>(static_cast<R>(v)) - flo) * scale;
+				if (t >= F() && t < nbins) ++bins[static_cast<std::size_t>(t)];
+			}
+		}
+	}
+};
+
+//Visit<0>(lo, hi, mask) resizes mask to the size of the container,
+//sets mask[i] = 1 if lo <= c[i] < hi and 0 otherwise, then returns the number of 1.
+template <class R = double>
+struct FilterToMask
+{
+	using ArgTypes = std::tuple<R, R, std::vector<unsigned char>&>;
+	using RetType = std::size_t;
+	template <class Container>
+	std::size_t operator()(R lo, R hi, std::vector<unsigned char>& mask, const Container& c) const
+	{
+		mask.resize(std::size(c));
+		if constexpr (detail::IsArithmeticArrayV<Container>) return detail::DispatchSimd<detail::MaskKernel<R, detail::ElementT<Container>>>(lo, hi, c.data(), mask.data(), c.size());
+		else
+		{
+			std::size_t count = 0, i = 0;
+			for (const auto& v : c)
+			{
+				R r = static_cast<R>(v);
+				unsigned char m = static_cast<unsigned char>(lo <= r && r < hi);
+				mask[i++] = m;
+				count += m;
+			}
+			return count;
+		}
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "AnyRefIPC.h"
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <sys/wait.h>
+
+//Measures the throughput of ShmChannel between local processes.
+//The producers send int64_t and Vec3 alternately, and the consumer adds them up through Generics.
+
+using namespace anyref;
+
+struct Vec3
+{
+	double x, y, z;
+};
+
+struct Summable
+{
+	using ArgTypes = std::tuple<double&>;
+	using RetType = void;
+	void operator()(double& sum, std::int64_t v) const { sum += static_cast<double>(v); }
+	void operator()(double& sum, const Vec3& v) const { sum += v.x + v.y + v.z; }
+};
+void Accumulate(Generics<AnyCRef, Summable> a, double& sum)
+{
+	a.Visit<0>(sum);
+}
+
+template <class Producer>
+void Produce(const char* name, std::int64_t begin, std::int64_t end)
+{
+	ShmChannel<Producer> ch(name);
+	for (std::int64_t i = begin; i < end; ++i)
+	{
+		if (i % 2 == 0) ch.Send(i);
+		else ch.Send(Vec3{ (double)i, 0., 0. });
+	}
+}
+
+template <class Producer>
+void Run(const char* label, int num_producers, std::int64_t num_messages)
+{
+	const char* name = "/anyref_bench_ipc";
+	shm_unlink(name);
+	ShmChannel<Producer> ch(name, 1024, sizeof(Vec3));
+
+	auto start = std::chrono::steady_clock::now();
+	std::int64_t per_producer = num_messages / num_producers;
+	for (int p = 0; p < num_producers; ++p)
+	{
+		if (fork() == 0)
+		{
+			Produce<Producer>(name, p * per_producer, (p + 1) * per_producer);
+			_exit(0);
+		}
+	}
+	double sum = 0.;
+	std::int64_t received = 0;
+	for (; received < per_producer * num_producers; ++received)
+	{
+		auto m = ch.Receive();
+		m.template Apply<std::int64_t, Vec3>([&sum](const auto& v) { Accumulate(v, sum); });
+	}
+	auto end = std::chrono::steady_clock::now();
+	for (int p = 0; p < num_producers; ++p) wait(nullptr);
+
+	double n = (double)(per_producer * num_producers);
+	double expected = n * (n - 1) / 2;
+	double sec = std::chrono::duration<double>(end - start).count();
+	std::cout << label << ": " << received << " messages in " << sec << " s, "
+		<< (double)received / sec << " messages/s" << (sum == expected ? "" : " (checksum mismatch)") << std::endl;
+}
+
+int main()
+{
+	const std::int64_t n = 10000000;
+	Run<SingleProducer>("SingleProducer, 1 producer ", 1, n);
+	Run<MultiProducer>("MultiProducer,  1 producer ", 1, n);
+	Run<MultiProducer>("MultiProducer,  2 producers", 2, n);
+	Run<MultiProducer>("MultiProducer,  4 producers", 4, n);
+}
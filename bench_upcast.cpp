@@ -0,0 +1,80 @@
+#include "AnyRef.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+//Measures the cost of AnyCRef::Get<Base>() on a reference to a class deeply derived from Base,
+//compared with Get<> of the exact type and with the Is<> cascade over every derived type.
+
+using namespace anyref;
+
+template <int N>
+struct Level : Level<N - 1>
+{
+	int mLevel = N;
+};
+template <>
+struct Level<0>
+{
+	virtual ~Level() = default;
+	int mLevel = 0;
+};
+//gives the base subobject a non-zero offset.
+struct Mixin
+{
+	virtual ~Mixin() = default;
+	double mMixin = 0.;
+};
+constexpr int Depth = 32;
+struct Leaf : Mixin, Level<Depth> {};
+
+template <class Func>
+void Measure(const char* label, Func f)
+{
+	const int n = 10000000;
+	long long sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < n; ++i) sum += f();
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration<double, std::nano>(end - start).count() / n;
+	std::cout << label << ": " << ns << " ns/call (checksum " << sum << ")" << std::endl;
+}
+
+template <int N>
+int GetLevelByCascade(const AnyCRef& a)
+{
+	if constexpr (N < 0) return -1;
+	else
+	{
+		if (a.Is<Level<N>>()) return a.Get<Level<N>>().mLevel;
+		return GetLevelByCascade<N - 1>(a);
+	}
+}
+
+int main()
+{
+	Leaf leaf;
+	AnyCRef a = leaf;
+
+	auto start = std::chrono::steady_clock::now();
+	int first = a.Get<Level<0>>().mLevel;
+	auto end = std::chrono::steady_clock::now();
+	std::cout << "first Get<Base> (fills the cache): " << std::chrono::duration<double, std::nano>(end - start).count()
+		<< " ns (level " << first << ")" << std::endl;
+
+	Measure("Get<Leaf> (exact type)         ", [&a]() { return a.Get<Leaf>().mLevel; });
+	Measure("Get<Level<0>> (cached upcast)  ", [&a]() { return a.Get<Level<0>>().mLevel; });
+	Measure("Get<Level<16>> (cached upcast) ", [&a]() { return a.Get<Level<16>>().mLevel; });
+	Measure("Is<Mixin> (cached upcast)      ", [&a]() { return (int)a.Is<Mixin>(); });
+	Measure("Is<std::vector<int>> (negative)", [&a]() { return (int)a.Is<std::vector<int>>(); });
+	Measure("Is<> cascade over 33 levels    ", [&a]() { return GetLevelByCascade<Depth>(a); });
+
+	//a reference to a non-class type is rejected before the cache.
+	int i = 0;
+	AnyCRef c = i;
+	Measure("Is<Mixin> on int               ", [&c]() { return (int)c.Is<Mixin>(); });
+
+	//the cache is keyed by the referenced type, so a reference through a base class type is another entry.
+	AnyCRef b = static_cast<const Level<Depth / 2>&>(leaf);
+	Measure("Get<Level<0>> via Level<16>&   ", [&b]() { return b.Get<Level<0>>().mLevel; });
+}
@@ -1,4 +1,5 @@
 #include "AnyRef.h"
+#include "AnyRefKernels.h"
 #include <iostream>
 #include <vector>
 #include <map>
@@ -6,6 +7,10 @@
 #include <numeric>
 #include <array>
 #include <optional>
+#include <memory>
+#if defined(__unix__) || defined(__APPLE__)
+#include "AnyRefIPC.h"
+#endif
 
 using namespace anyref;
 
@@ -255,6 +260,196 @@ void ExampleRuntimeVariadicGenerics()
 	delete b;
 }
 
+void FuncArithmeticKernels(Generics<AnyCRef, std::tuple<Sum<>, MinMax<>, Histogram<>, FilterToMask<>>> a)
+{
+	//The built-in visitors in AnyRefKernels.h accept any container of arithmetic values.
+	//Contiguous containers are processed by vectorizable kernels, the others by iterator loops.
+	auto [min, max] = a.Visit<1>();
+	std::cout << "sum == " << a.Visit<0>() << ", min == " << min << ", max == " << max << std::endl;
+	std::vector<std::size_t> bins(4);
+	a.Visit<2>(0., 8., bins);
+	std::cout << "histogram of [0, 8) ==";
+	for (auto b : bins) std::cout << " " << b;
+	std::cout << std::endl;
+	std::vector<unsigned char> mask;
+	std::size_t n = a.Visit<3>(2., 6., mask);
+	std::cout << n << " elements in [2, 6), mask ==";
+	for (auto m : mask) std::cout << " " << (int)m;
+	std::cout << std::endl;
+}
+void FuncAxpy(Generics<std::tuple<AnyCRef, AnyRef>, Axpy<>> a, double s)
+{
+	a.Visit<0>(s);
+}
+void ExampleArithmeticKernels()
+{
+	std::vector<int> vi{ 1, 2, 3, 4, 5, 6, 7 };
+	FuncArithmeticKernels(vi);
+	std::vector<double> vd{ 0.5, 1.5, 2.5, 3.5, 4.5, 5.5, 6.5 };
+	FuncArithmeticKernels(vd);
+	std::list<float> lf{ 7.f, 3.f, 5.f };
+	FuncArithmeticKernels(lf);
+
+	FuncAxpy(std::forward_as_tuple(vi, vd), 2.);
+	std::cout << "result of Axpy with std::vector<int> and std::vector<double> ==";
+	for (auto d : vd) std::cout << " " << d;
+	std::cout << std::endl;
+
+	//a narrow R counts many more elements than its own range.
+	std::vector<short> many(1000000, 1);
+	std::vector<unsigned char> mask;
+	std::cout << "FilterToMask<short> over 1000000 elements == " << FilterToMask<short>()(0, 2, mask, many)
+		<< ", FilterToMask<signed char> == " << FilterToMask<signed char>()(0, 2, mask, many) << std::endl;
+}
+
+void FuncNumericCoercion(AnyCRef a)
+{
+	//GetAs converts the referenced arithmetic value to the requested type,
+	//so a single non-template function can handle int, float, double, ... at once.
+	if (a.IsArithmetic()) std::cout << "a as double == " << a.GetAs<double>() << std::endl;
+	else if (a.IsArithmeticArray())
+	{
+		//GetArrayAs converts the whole container into the given buffer.
+		std::vector<double> buf(a.GetArraySize());
+		a.GetArrayAs(buf.data(), buf.size());
+		std::cout << "a as double array ==";
+		for (auto d : buf) std::cout << " " << d;
+		std::cout << std::endl;
+	}
+	else std::cout << "a is not arithmetic" << std::endl;
+}
+void ExampleNumericCoercion()
+{
+	FuncNumericCoercion(1);
+	FuncNumericCoercion(2.5f);
+	FuncNumericCoercion('A');
+	FuncNumericCoercion(std::vector<int>{ 1, 2, 3 });
+	FuncNumericCoercion(std::array<float, 3>{ 4.5f, 5.5f, 6.5f });
+	FuncNumericCoercion(std::string("abc"));
+	FuncNumericCoercion(std::list<int>{ 1, 2, 3 });
+	std::optional<int> i = AnyCRef(3.9).TryGetAs<int>();
+	std::optional<int> j = AnyCRef(std::list<int>{}).TryGetAs<int>();
+	std::cout << "TryGetAs<int> with 3.9 == " << *i << ", with std::list<int> has_value == " << j.has_value() << std::endl;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+struct Point
+{
+	int x, y;
+};
+struct Printable
+{
+	using ArgTypes = std::tuple<>;
+	using RetType = void;
+	void operator()(int v) const { std::cout << "int " << v; }
+	void operator()(double v) const { std::cout << "double " << v; }
+	void operator()(const Point& p) const { std::cout << "Point (" << p.x << ", " << p.y << ")"; }
+};
+void FuncShmChannel(Generics<AnyCRef, Printable> a)
+{
+	std::cout << "received ";
+	a.Visit<0>();
+	std::cout << std::endl;
+}
+void ExampleShmChannel()
+{
+	const char* name = "/anyref_example";
+	shm_unlink(name);//removes the channel left by an aborted run.
+	ShmChannel<> consumer(name, 16, sizeof(Point));
+	{
+		//usually opened in another process.
+		ShmChannel<> producer(name);
+		producer.Send(1);
+		producer.Send(2.5);
+		producer.Send(Point{ 3, 4 });
+		producer.Send(5.5f);
+	}
+	while (ShmChannel<>::Message m = consumer.TryReceive())
+	{
+		//Apply gives the payload to Generics with its concrete type.
+		if (m.Apply<int, double, Point>([](const auto& v) { FuncShmChannel(v); })) continue;
+		//GetRef gives it as AnyCRef.
+		if (m.Is<float>()) FuncNumericCoercion(m.GetRef<float>());
+	}
+}
+#endif
+
+struct Shape
+{
+	virtual ~Shape() = default;
+	virtual double Area() const = 0;
+};
+struct Named
+{
+	std::string mName;
+};
+struct Rectangle : Named, Shape
+{
+	Rectangle(double w, double h) : Named{ "rectangle" }, mWidth(w), mHeight(h) {}
+	virtual double Area() const { return mWidth * mHeight; }
+	double mWidth, mHeight;
+};
+struct Square : Rectangle
+{
+	Square(double a) : Rectangle(a, a) { mName = "square"; }
+};
+void FuncInheritance(AnyCRef a)
+{
+	//Is<Base> and Get<Base> also accept references to derived classes.
+	if (a.Is<Named>()) std::cout << "a is " << a.Get<Named>().mName;
+	else std::cout << "a is " << a.GetTypeIndex().name();
+	if (a.Is<Shape>()) std::cout << ", area == " << a.Get<Shape>().Area();
+	std::cout << std::endl;
+}
+//the position of a virtual base class depends on the complete object.
+struct Tagged
+{
+	int mTag = 0;
+};
+struct Item : virtual Tagged {};
+struct PaddedItem : Item
+{
+	PaddedItem() { mTag = 1; }
+	long mPadding[4] = {};
+};
+struct Node
+{
+	virtual ~Node() = default;
+	int mId = 0;
+};
+struct Link : virtual Node {};
+struct Left : Link
+{
+	long mLeft[3] = {};
+};
+struct Right : Link
+{
+	long mRight[5] = {};
+};
+struct Diamond : Left, Right
+{
+	Diamond() { mId = 2; }
+};
+void FuncVirtualBase(AnyCRef a)
+{
+	if (a.Is<Tagged>()) std::cout << "tag == " << a.Get<Tagged>().mTag << std::endl;
+	if (a.Is<Node>()) std::cout << "id == " << a.Get<Node>().mId << std::endl;
+}
+void ExampleInheritance()
+{
+	FuncInheritance(Rectangle(2., 3.));
+	FuncInheritance(Square(4.));
+	FuncInheritance(1);
+	//the same static type Item, but different offsets of Tagged.
+	FuncVirtualBase(Item());
+	PaddedItem padded;
+	FuncVirtualBase(static_cast<const Item&>(padded));
+	//two Link subobjects of one Diamond, sharing one Node.
+	Diamond diamond;
+	FuncVirtualBase(static_cast<const Link&>(static_cast<const Left&>(diamond)));
+	FuncVirtualBase(static_cast<const Link&>(static_cast<const Right&>(diamond)));
+}
+
 int main()
 {
 	std::cout << "-----Exmaple AnyCRef-----" << std::endl;
@@ -280,4 +475,18 @@ int main()
 	std::cout << std::endl;
 	std::cout << "-----Exmaple RuntimeVariadicGenerics-----" << std::endl;
 	ExampleRuntimeVariadicGenerics();
+	std::cout << std::endl;
+	std::cout << "-----Exmaple ArithmeticKernels-----" << std::endl;
+	ExampleArithmeticKernels();
+	std::cout << std::endl;
+	std::cout << "-----Exmaple NumericCoercion-----" << std::endl;
+	ExampleNumericCoercion();
+	std::cout << std::endl;
+#if defined(__unix__) || defined(__APPLE__)
+	std::cout << "-----Exmaple ShmChannel-----" << std::endl;
+	ExampleShmChannel();
+	std::cout << std::endl;
+#endif
+	std::cout << "-----Exmaple Inheritance-----" << std::endl;
+	ExampleInheritance();
 }